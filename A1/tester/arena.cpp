@@ -0,0 +1,55 @@
+#include "arena.h"
+#include <algorithm>
+
+Arena::Arena(size_t blockSize)
+    : blockSize(blockSize), currentBlock(0), offset(0),
+      numHeapAllocations(0), reserved(0), used(0), peak(0), served(0), resets(0) {}
+
+void Arena::addBlock(size_t minSize) {
+    size_t size = std::max(blockSize, minSize);
+    if(!blocks.empty())
+        size = std::max(size, blocks.back().size * 2);
+
+    blocks.push_back({std::unique_ptr<char[]>(new char[size]), size});
+    numHeapAllocations++;
+    reserved += size;
+}
+
+void* Arena::allocate(size_t bytes, size_t alignment) {
+    while(true) {
+        if(currentBlock < blocks.size()) {
+            Block& block = blocks[currentBlock];
+            uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+            size_t aligned = ((base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+            if(aligned + bytes <= block.size) {
+                used += aligned + bytes - offset;
+                offset = aligned + bytes;
+                peak = std::max(peak, used);
+                served += bytes;
+                return block.data.get() + aligned;
+            }
+            // the tail of this block is wasted, move on to the next retained one
+            used += block.size - offset;
+            currentBlock++;
+            offset = 0;
+            continue;
+        }
+        addBlock(bytes + alignment);
+    }
+}
+
+void Arena::reset() {
+    // collapse a grown arena into one block so steady state is a single bump region
+    if(blocks.size() > 1) {
+        size_t total = reserved;
+        blocks.clear();
+        reserved = 0;
+        blocks.push_back({std::unique_ptr<char[]>(new char[total]), total});
+        numHeapAllocations++;
+        reserved = total;
+    }
+    currentBlock = 0;
+    offset = 0;
+    used = 0;
+    resets++;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <map>
+#include <functional>
+
+// Monotonic block allocator. allocate() bumps a pointer inside the current
+// block, deallocation is a no-op and reset() rewinds without returning memory,
+// so once the arena has grown to its high-water mark it never touches the heap.
+class Arena {
+    public:
+        explicit Arena(size_t blockSize = 1 << 16);
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+        void reset();
+
+        size_t heapAllocations() const { return numHeapAllocations; }
+        size_t bytesReserved() const { return reserved; }
+        size_t bytesInUse() const { return used; }
+        size_t peakBytes() const { return peak; }
+        size_t totalBytesServed() const { return served; }
+        size_t numResets() const { return resets; }
+
+    private:
+        struct Block {
+            std::unique_ptr<char[]> data;
+            size_t size;
+        };
+
+        void addBlock(size_t minSize);
+
+        std::vector<Block> blocks;
+        size_t blockSize;
+        size_t currentBlock;
+        size_t offset;
+
+        size_t numHeapAllocations;
+        size_t reserved;
+        size_t used;
+        size_t peak;
+        size_t served;
+        size_t resets;
+};
+
+template <typename T>
+class ArenaAllocator {
+    public:
+        using value_type = T;
+
+        explicit ArenaAllocator(Arena& arena) : arena(&arena) {}
+        template <typename U>
+        ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+        T* allocate(size_t n) {
+            return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+        }
+        void deallocate(T*, size_t) {}
+
+        template <typename U>
+        bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+        template <typename U>
+        bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+
+    private:
+        template <typename U> friend class ArenaAllocator;
+        Arena* arena;
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+template <typename K, typename V>
+using ArenaMap = std::map<K, V, std::less<K>, ArenaAllocator<std::pair<const K, V>>>;
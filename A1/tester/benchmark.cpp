@@ -7,18 +7,23 @@
 using namespace std;
 using namespace std::chrono;
 
-// Generate test data
-vector<uint64_t> generateTestData(int size) {
+// Generate test data, stock ids are uniform or Zipf(1) distributed (a few hot symbols)
+vector<uint64_t> generateTestData(int size, bool zipf) {
     vector<uint64_t> orderBook;
     random_device rd;
     mt19937 gen(42); // Fixed seed for reproducibility
-    uniform_int_distribution<uint32_t> stockDist(1, min(size/10, 1000));
+    int numStocks = min(size/10, 1000);
+    uniform_int_distribution<uint32_t> stockDist(1, numStocks);
+    vector<double> zipfWeights;
+    for(int k = 1; k <= numStocks; k++)
+        zipfWeights.push_back(1.0 / k);
+    discrete_distribution<uint32_t> zipfDist(zipfWeights.begin(), zipfWeights.end());
     uniform_int_distribution<int> typeDist(0, 1);
     uniform_int_distribution<int> qtyDist(1, 100);
     uniform_int_distribution<int> valueDist(1, 100);
     
     for(int i = 0; i < size; i++) {
-        uint32_t stockID = stockDist(gen);
+        uint32_t stockID = zipf ? zipfDist(gen) + 1 : stockDist(gen);
         bool orderType = typeDist(gen);
         uint8_t orderQty = qtyDist(gen);
         uint8_t orderValue = valueDist(gen);
@@ -47,16 +52,38 @@ void benchmarkFunction(const string& name, function<void()> func, int threads) {
     cout << name << " with " << threads << " threads: " << duration << " ms" << endl;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     vector<int> sizes = {10000, 100000, 1000000};
     vector<int> thread_counts = {1, 2, 4, 8};
+
+    // --numa: first-touch the order book per thread count and pin threads to cores
+    // --zipf: skewed stock ids instead of uniform ones
+    bool numa = false, zipf = false;
+    for(int i = 1; i < argc; i++) {
+        numa |= string(argv[i]) == "--numa";
+        zipf |= string(argv[i]) == "--zipf";
+    }
+    OrderBookContext& ctx = defaultContext();
+    ctx.setThreadPinning(numa);
+    string csvName = string("benchmark_results") + (numa ? "_numa" : "") + (zipf ? "_zipf" : "") + ".csv";
     
-    ofstream csvFile("benchmark_results.csv");
+    ofstream csvFile(csvName);
     csvFile << "Function,Size,Threads,Time_ms,Speedup\n";
     
     for(int size : sizes) {
         cout << "\n=== Testing with " << size << " orders ===" << endl;
-        auto orderBook = generateTestData(size);
+        auto orderBook = generateTestData(size, zipf);
+        map<int, OrderBookBuffer> numaBooks;
+        for(int threads : thread_counts) {
+            omp_set_num_threads(threads);
+            if(numa) {
+                ctx.prepare(threads);
+                numaBooks[threads] = OrderBookBuffer::copyOf(orderBook);
+            }
+        }
+        auto bookFor = [&](int threads) {
+            return numa ? OrderBookView(numaBooks[threads]) : OrderBookView(orderBook);
+        };
         
         // Benchmark totalAmountTraded
         map<int, double> totalAmountTimes;
@@ -64,7 +91,7 @@ int main() {
             omp_set_num_threads(threads);
             
             auto start = high_resolution_clock::now();
-            int64_t result = totalAmountTraded(orderBook);
+            int64_t result = totalAmountTraded(bookFor(threads));
             auto end = high_resolution_clock::now();
             
             double time_ms = duration_cast<microseconds>(end - start).count() / 1000.0;
@@ -77,6 +104,8 @@ int main() {
             cout << "totalAmountTraded [" << threads << " threads]: " 
                  << time_ms << " ms (speedup: " << speedup << "x)" << endl;
         }
+        cout << "totalAmountTraded load balance [" << thread_counts.back() << " threads]:" << endl;
+        ctx.scheduler().reportLoadBalance(cout);
         
         // Benchmark printOrderStats
         map<int, double> statsTimes;
@@ -84,7 +113,7 @@ int main() {
             omp_set_num_threads(threads);
             
             auto start = high_resolution_clock::now();
-            printOrderStats(orderBook);
+            printOrderStats(bookFor(threads));
             auto end = high_resolution_clock::now();
             
             double time_ms = duration_cast<milliseconds>(end - start).count();
@@ -97,6 +126,8 @@ int main() {
             cout << "printOrderStats [" << threads << " threads]: " 
                  << time_ms << " ms (speedup: " << speedup << "x)" << endl;
         }
+        cout << "printOrderStats load balance [" << thread_counts.back() << " threads]:" << endl;
+        ctx.scheduler().reportLoadBalance(cout);
         
         // Benchmark updateDisplay (small freq for testing)
         int freq = size / 10;
@@ -105,7 +136,7 @@ int main() {
             omp_set_num_threads(threads);
             
             auto start = high_resolution_clock::now();
-            updateDisplay(orderBook, freq);
+            updateDisplay(bookFor(threads), freq);
             auto end = high_resolution_clock::now();
             
             double time_ms = duration_cast<milliseconds>(end - start).count();
@@ -118,10 +149,15 @@ int main() {
             cout << "updateDisplay [" << threads << " threads]: " 
                  << time_ms << " ms (speedup: " << speedup << "x)" << endl;
         }
+        cout << "updateDisplay load balance [" << thread_counts.back() << " threads]:" << endl;
+        ctx.scheduler().reportLoadBalance(cout);
     }
     
     csvFile.close();
-    cout << "\nResults saved to benchmark_results.csv" << endl;
+    cout << "\nResults saved to " << csvName << endl;
+
+    cout << "\nAllocator statistics:" << endl;
+    defaultContext().reportAllocatorStats(cout);
     
     return 0;
 }
\ No newline at end of file
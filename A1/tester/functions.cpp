@@ -1,5 +1,7 @@
 #include "functions.h"
 #include <chrono>
+#include <atomic>
+#include <filesystem>
 using namespace std;
 
 class OrderBookEntry {
@@ -88,182 +90,262 @@ OrderBookEntry decodePacket(uint64_t encodedPacket) {
 
 
 
-void generateSnapShot(int snapShotID, const map<uint32_t, StockInfo>& stockData) {
-    string filename = "snap_" + to_string(snapShotID) + ".txt";
-    ofstream outFile(filename);
+struct SnapShotEntry {
+    uint32_t stockID;
+    uint8_t lastSellValue;
+    uint8_t lastBuyValue;
+    int spread;
+};
+
+using StockMap = ArenaMap<uint32_t, StockInfo>;
+
+// estimated cost of creating and flushing one snapshot file, in sorted entries
+static const uint64_t SNAPSHOT_FILE_COST = 256;
+
+void applyOrder(StockMap& stockData, const OrderBookEntry& entry) {
+    StockInfo& info = stockData[entry.stockID];
+    if(entry.orderType == 0) {
+        info.lastBuyValue = entry.orderValue;
+        info.hasBuy = true;
+    }
+    else {
+        info.lastSellValue = entry.orderValue;
+        info.hasSell = true;
+    }
+}
+
+void appendSnapShotEntries(ArenaVector<SnapShotEntry>& entries, const StockMap& stockData) {
+    for(const auto& [stockID, stockInfo]:stockData)
+        entries.push_back({stockID, stockInfo.lastSellValue, stockInfo.lastBuyValue, stockInfo.getSpread()});
+}
+
+// Opens the thread's reusable stream on its own buffer, so no filebuf is allocated per file.
+bool openOutput(ThreadScratch& scratch, const char* filename) {
+    ofstream& outFile = scratch.outFile;
+    outFile.clear();
+    outFile.flags(ios_base::skipws | ios_base::dec);
+    outFile.precision(6);
+    outFile.rdbuf()->pubsetbuf(scratch.fileBuffer, sizeof(scratch.fileBuffer));
+    outFile.open(filename);
 
     if(!outFile.is_open()) {
         cerr << "Error opening file: " << filename << endl;
-        return;
+        return false;
     }
+    return true;
+}
 
-    struct SnapShotEntry {
-        uint32_t stockID;
-        uint8_t lastSellValue;
-        uint8_t lastBuyValue;
-        int spread;
-    };
-    vector<SnapShotEntry> snapShotEntries;
-    for(const auto& [stockID, stockInfo]:stockData) {
-        SnapShotEntry entry;
-        entry.stockID = stockID;
-        entry.lastBuyValue = stockInfo.lastBuyValue;
-        entry.lastSellValue = stockInfo.lastSellValue;
-        entry.spread = stockInfo.getSpread();
-        snapShotEntries.push_back(entry);
+// Sorts [begin, end) in place and writes it out as <outputPrefix>snap_<snapShotID>.txt
+bool generateSnapShot(int snapShotID, SnapShotEntry* begin, SnapShotEntry* end, ThreadScratch& scratch, const char* outputPrefix = "") {
+    int length = snprintf(scratch.filename, sizeof(scratch.filename), "%ssnap_%d.txt", outputPrefix, snapShotID);
+    if(length < 0 || length >= (int)sizeof(scratch.filename)) {
+        cerr << "Output path too long: " << outputPrefix << endl;
+        return false;
     }
+    if(!openOutput(scratch, scratch.filename))
+        return false;
 
-    sort(snapShotEntries.begin(), snapShotEntries.end(), [](const auto& a, const auto& b) {
+    sort(begin, end, [](const auto& a, const auto& b) {
         if(a.spread != b.spread) return a.spread > b.spread;
         else return a.stockID > b.stockID;
     });
 
-    for(auto& entry:snapShotEntries)
-        outFile << entry.stockID << " " << (int)entry.lastSellValue << " " << (int)entry.lastBuyValue << " " << entry.spread << "\n";
+    ofstream& outFile = scratch.outFile;
+    for(auto* entry=begin;entry!=end;entry++)
+        outFile << entry->stockID << " " << (int)entry->lastSellValue << " " << (int)entry->lastBuyValue << " " << entry->spread << "\n";
     
     outFile.close();
+    return (bool)outFile;
 }
 
-void updateDisplay(const std::vector<uint64_t> &orderBook, int32_t freq){
-    int n = orderBook.size();
-    int numSanpShots = 1 + (n/freq);
-
-    vector<map<uint32_t, StockInfo>> snapShotData(numSanpShots);
-    map<uint32_t, StockInfo> currentData;
-    int currentSnapShotID = 0;
-
-    for(int i=0;i<n;i++) {
-        OrderBookEntry entry = decodePacket(orderBook[i]);
-        if(currentData.find(entry.stockID) == currentData.end())
-            currentData[entry.stockID] = StockInfo();
-        if(entry.orderType == 0) {
-            currentData[entry.stockID].lastBuyValue = entry.orderValue;
-            currentData[entry.stockID].hasBuy = true;
-        }
-        else {
-            currentData[entry.stockID].lastSellValue = entry.orderValue;
-            currentData[entry.stockID].hasSell = true;
-        }
+// Writes snapshots firstOrder/freq .. (firstOrder + orderBook.size())/freq. orderBook holds the
+// orders from global index firstOrder on and currentData is the state before them; snapshot k
+// covers the first min((k+1)*freq, n) orders of the whole book. False if any file failed.
+bool buildSnapShots(OrderBookView orderBook, size_t firstOrder, int32_t freq, StockMap& currentData, OrderBookContext &ctx,
+                    const char* outputPrefix = ""){
+    size_t n = firstOrder + orderBook.size();
+    int firstSnapShotID = firstOrder/freq;
+    int numSanpShots = 1 + (n/freq) - firstSnapShotID;
+
+    // all snapshots live back to back in one buffer, snapShotStart[k] .. snapShotStart[k+1]
+    ArenaVector<SnapShotEntry> snapShotEntries{ArenaAllocator<SnapShotEntry>(ctx.shared())};
+    ArenaVector<size_t> snapShotStart(numSanpShots + 1, 0, ArenaAllocator<size_t>(ctx.shared()));
+
+    size_t i = firstOrder;
+    for(int k=0;k<numSanpShots;k++) {
+        // the last snapshot may be a partial interval, or repeat the full book when n%freq == 0
+        size_t end = min((size_t)(firstSnapShotID + k + 1) * freq, n);
+        for(;i<end;i++)
+            applyOrder(currentData, decodePacket(orderBook[i - firstOrder]));
+
+        appendSnapShotEntries(snapShotEntries, currentData);
+        snapShotStart[k+1] = snapShotEntries.size();
+    }
 
-        if((i+1)%freq == 0) {
-            snapShotData[currentSnapShotID] = currentData;
-            currentSnapShotID++;
+    // one job per snapshot, costed as sorting its entries plus a fixed file overhead
+    ArenaVector<WorkItem> jobs(numSanpShots, WorkItem{}, ArenaAllocator<WorkItem>(ctx.shared()));
+    for(int k=0;k<numSanpShots;k++) {
+        uint64_t entries = snapShotStart[k+1] - snapShotStart[k];
+        jobs[k] = {(size_t)k, (size_t)k + 1, entries * (1 + (uint64_t)log2(entries + 1)) + SNAPSHOT_FILE_COST};
+    }
 
-            if(n%freq == 0 && (i+1)==n) {
-                snapShotData[currentSnapShotID] = currentData;
-                currentSnapShotID++;
-            }
+    atomic<bool> failed(false);
+    ctx.scheduler().run(jobs.data(), jobs.size(), [&](const WorkItem& job, int thread_id) {
+        for(size_t k=job.first;k<job.last;k++) {
+            if(!generateSnapShot(firstSnapShotID + k, snapShotEntries.data() + snapShotStart[k], snapShotEntries.data() + snapShotStart[k+1],
+                                 ctx.thread(thread_id), outputPrefix))
+                failed = true;
         }
-    }
+    });
+    return !failed;
+}
+
+void updateDisplay(OrderBookView orderBook, int32_t freq){
+    updateDisplay(orderBook, freq, defaultContext());
+}
 
-    #pragma omp parallel for schedule(dynamic)
-    for(int i=0;i<numSanpShots;i++)
-        generateSnapShot(i, snapShotData[i]);
+void updateDisplay(OrderBookView orderBook, int32_t freq, OrderBookContext &ctx){
+    ctx.prepare(omp_get_max_threads());
+    StockMap currentData{ArenaAllocator<StockMap::value_type>(ctx.shared())};
+    buildSnapShots(orderBook, 0, freq, currentData, ctx);
 }
 
-int64_t totalAmountTraded(const std::vector<uint64_t> &orderBook)
+int64_t sumTradeAmounts(OrderBookView orderBook, OrderBookContext &ctx)
 {
     int n = orderBook.size();
-    int64_t totalAmout = 0;
+    int num_threads = omp_get_max_threads();
 
-    #pragma omp parallel for reduction(+:totalAmout) schedule(static)
-    for(int i=0;i<n;i++) {
-        OrderBookEntry entry = decodePacket(orderBook[i]);
-        int64_t tradeAmount = (int64_t)entry.orderQty * (int64_t)entry.orderValue;
-        totalAmout += tradeAmount;
-    }
+    struct alignas(64) PartialSum {
+        int64_t value;
+    };
+    ArenaVector<PartialSum> partialSums(num_threads, PartialSum{0}, ArenaAllocator<PartialSum>(ctx.shared()));
+
+    size_t numChunks = numOrderChunks(n, num_threads);
+    ArenaVector<WorkItem> chunks(numChunks, WorkItem{}, ArenaAllocator<WorkItem>(ctx.shared()));
+    makeOrderChunks(n, chunks.data(), numChunks);
 
+    ctx.scheduler().run(chunks.data(), numChunks, [&](const WorkItem& chunk, int thread_id) {
+        int64_t chunkAmount = 0;
+        for(size_t i=chunk.first;i<chunk.last;i++) {
+            OrderBookEntry entry = decodePacket(orderBook[i]);
+            int64_t tradeAmount = (int64_t)entry.orderQty * (int64_t)entry.orderValue;
+            chunkAmount += tradeAmount;
+        }
+        partialSums[thread_id].value += chunkAmount;
+    });
+
+    int64_t totalAmout = 0;
+    for(auto& partial:partialSums)
+        totalAmout += partial.value;
     return totalAmout;
 }
 
-void printOrderStats(const std::vector<uint64_t> &orderBook)
+int64_t totalAmountTraded(OrderBookView orderBook)
 {
-    int n = orderBook.size();
-    
-    struct StockStats {
-        uint32_t stockID;
-        uint8_t minSellValue;
-        uint8_t maxBuyValue;
-        int64_t totalValue;
-        int64_t orderCount;
-        bool hasSell;
-        bool hasBuy;
-
-        StockStats() : stockID(0), minSellValue(255), maxBuyValue(0), totalValue(0), orderCount(0), hasSell(false), hasBuy(false) {}
-    };
+    return totalAmountTraded(orderBook, defaultContext());
+}
+
+int64_t totalAmountTraded(OrderBookView orderBook, OrderBookContext &ctx)
+{
+    ctx.prepare(omp_get_max_threads());
+    return sumTradeAmounts(orderBook, ctx);
+}
+
+struct StockStats {
+    uint32_t stockID;
+    uint8_t minSellValue;
+    uint8_t maxBuyValue;
+    int64_t totalValue;
+    int64_t orderCount;
+    bool hasSell;
+    bool hasBuy;
+
+    StockStats() : stockID(0), minSellValue(255), maxBuyValue(0), totalValue(0), orderCount(0), hasSell(false), hasBuy(false) {}
+};
+using StatsMap = ArenaMap<uint32_t, StockStats>;
+using StatsAllocator = ArenaAllocator<StatsMap::value_type>;
+
+void mergeStats(StatsMap& statsData, const StatsMap& partial) {
+    for(auto& [stockID, local_stats] : partial) {
+        auto [it, inserted] = statsData.try_emplace(stockID, local_stats);
+        if(!inserted) {
+            StockStats& global_stats = it->second;
+            
+            if(local_stats.hasSell) {
+                global_stats.hasSell = true;
+                global_stats.minSellValue = min(global_stats.minSellValue, local_stats.minSellValue);
+            }
+            
+            if(local_stats.hasBuy) {
+                global_stats.hasBuy = true;
+                global_stats.maxBuyValue = max(global_stats.maxBuyValue, local_stats.maxBuyValue);
+            }
+            
+            global_stats.totalValue += local_stats.totalValue;
+            global_stats.orderCount += local_stats.orderCount;
+        }
+    }
+}
 
+// Aggregates orderBook per stock and merges the result into statsData.
+void aggregateStats(OrderBookView orderBook, OrderBookContext &ctx, StatsMap& statsData)
+{
+    int n = orderBook.size();
     int num_threads = omp_get_max_threads();
-    vector<map<uint32_t, StockStats>> thread_local_data(num_threads);
 
-    #pragma omp parallel
-    {
-        int thread_id = omp_get_thread_num();
-        map<uint32_t, StockStats>& localData = thread_local_data[thread_id];
+    // each thread's map allocates its nodes from that thread's arena
+    ArenaVector<StatsMap> thread_local_data{ArenaAllocator<StatsMap>(ctx.shared())};
+    thread_local_data.reserve(num_threads);
+    for(int t=0;t<num_threads;t++)
+        thread_local_data.emplace_back(StatsAllocator(ctx.thread(t).arena));
 
-        #pragma omp for schedule(static)
-        for(int i=0;i<n;i++) {
+    size_t numChunks = numOrderChunks(n, num_threads);
+    ArenaVector<WorkItem> chunks(numChunks, WorkItem{}, ArenaAllocator<WorkItem>(ctx.shared()));
+    makeOrderChunks(n, chunks.data(), numChunks);
+
+    ctx.scheduler().run(chunks.data(), numChunks, [&](const WorkItem& chunk, int thread_id) {
+        StatsMap& localData = thread_local_data[thread_id];
+
+        for(size_t i=chunk.first;i<chunk.last;i++) {
             OrderBookEntry entry = decodePacket(orderBook[i]);
-            if(localData.find(entry.stockID) == localData.end()) {
-                localData[entry.stockID] = StockStats();
-                localData[entry.stockID].stockID = entry.stockID;
-            }
+            auto [it, inserted] = localData.try_emplace(entry.stockID);
+            StockStats& stats = it->second;
+            if(inserted)
+                stats.stockID = entry.stockID;
     
             //sell
             if(entry.orderType) {
-                localData[entry.stockID].hasSell = true;
-                localData[entry.stockID].minSellValue = min(entry.orderValue, localData[entry.stockID].minSellValue);
+                stats.hasSell = true;
+                stats.minSellValue = min(entry.orderValue, stats.minSellValue);
             }
             else { // Buy
-                localData[entry.stockID].hasBuy = true;
-                localData[entry.stockID].maxBuyValue = max(entry.orderValue, localData[entry.stockID].maxBuyValue);
+                stats.hasBuy = true;
+                stats.maxBuyValue = max(entry.orderValue, stats.maxBuyValue);
             }
     
-            localData[entry.stockID].totalValue += entry.orderValue;
-            localData[entry.stockID].orderCount++;
+            stats.totalValue += entry.orderValue;
+            stats.orderCount++;
         }
-    }
-
-    // merge thread results
-    map<uint32_t, StockStats> statsData;
-    for(auto& local_data : thread_local_data) {
-        for(auto& [stockID, local_stats] : local_data) {
-            if(statsData.find(stockID) == statsData.end()) {
-                statsData[stockID] = local_stats;
-            } else {
-                StockStats& global_stats = statsData[stockID];
-                
-                if(local_stats.hasSell) {
-                    global_stats.hasSell = true;
-                    global_stats.minSellValue = min(global_stats.minSellValue, local_stats.minSellValue);
-                }
-                
-                if(local_stats.hasBuy) {
-                    global_stats.hasBuy = true;
-                    global_stats.maxBuyValue = max(global_stats.maxBuyValue, local_stats.maxBuyValue);
-                }
-                
-                global_stats.totalValue += local_stats.totalValue;
-                global_stats.orderCount += local_stats.orderCount;
-            }
-        }
-    }
-
-    vector<StockStats> statsList;
-    for(auto& [stockID, stat]:statsData)
-        statsList.push_back(stat);
-
-    sort(statsList.begin(), statsList.end(), [](const auto& a, const auto& b) {
-        return a.stockID < b.stockID;
     });
 
-    ofstream outFile("stats.txt");
-    if(!outFile.is_open()) {
-        cerr << "Error opening stats.txt" << endl;
-        return;
+    // merge thread results, the map keeps them ordered by stockID
+    for(auto& local_data : thread_local_data)
+        mergeStats(statsData, local_data);
+}
+
+bool writeStats(const StatsMap& statsData, ThreadScratch& scratch, const char* outputPrefix = "")
+{
+    int length = snprintf(scratch.filename, sizeof(scratch.filename), "%sstats.txt", outputPrefix);
+    if(length < 0 || length >= (int)sizeof(scratch.filename)) {
+        cerr << "Output path too long: " << outputPrefix << endl;
+        return false;
     }
+    if(!openOutput(scratch, scratch.filename))
+        return false;
 
+    ofstream& outFile = scratch.outFile;
     outFile << fixed << setprecision(4);
-    for(auto& entry:statsList) {
+    for(auto& [stockID, entry]:statsData) {
         double avgValue = (double)entry.totalValue / (double)entry.orderCount;
         uint8_t minSell = entry.hasSell ? entry.minSellValue : 0;
         uint8_t maxBuy = entry.hasBuy ? entry.maxBuyValue : 0;
@@ -271,4 +353,505 @@ void printOrderStats(const std::vector<uint64_t> &orderBook)
         outFile << entry.stockID << " " << (int)minSell << " " << (int)maxBuy << " " << avgValue << "\n";
     }
     outFile.close();
-}
\ No newline at end of file
+    return (bool)outFile;
+}
+
+void printOrderStats(OrderBookView orderBook)
+{
+    printOrderStats(orderBook, defaultContext());
+}
+
+void printOrderStats(OrderBookView orderBook, OrderBookContext &ctx)
+{
+    ctx.prepare(omp_get_max_threads());
+    StatsMap statsData{StatsAllocator(ctx.shared())};
+    aggregateStats(orderBook, ctx, statsData);
+    writeStats(statsData, ctx.thread(0));
+}
+
+
+// Checkpoint index
+/*
+ File layout:
+ 1. CheckpointHeader
+ 2. numCheckpoints uint64 file offsets, one per checkpoint record
+ 3. checkpoint records: uint32 stock count, then per stock
+    stockID (4 bytes), lastBuyValue, lastSellValue, flags (1 byte each)
+
+ Checkpoint j holds the StockInfo state after the first j*interval orders, so
+ any snapshot can be rebuilt by replaying fewer than interval orders on top
+ of the nearest checkpoint.
+*/
+struct CheckpointHeader {
+    char magic[4];
+    uint32_t interval;
+    uint64_t numOrders;
+    uint64_t numCheckpoints;
+    uint64_t bookHash;
+};
+
+static const char CHECKPOINT_MAGIC[4] = {'O', 'B', 'C', 'K'};
+static const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+static const uint64_t FNV_PRIME = 1099511628211ULL;
+
+// FNV-1a over whole packets, continuing from hash so a book can be hashed in pieces
+uint64_t hashOrders(const uint64_t* orders, size_t count, uint64_t hash = FNV_OFFSET) {
+    for(size_t i=0;i<count;i++) {
+        hash ^= orders[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+void writeCheckpoint(ofstream& outFile, const StockMap& stockData) {
+    uint32_t numStocks = stockData.size();
+    outFile.write(reinterpret_cast<const char*>(&numStocks), sizeof(numStocks));
+    for(const auto& [stockID, stockInfo]:stockData) {
+        uint8_t flags = (stockInfo.hasBuy ? 1 : 0) | (stockInfo.hasSell ? 2 : 0);
+        outFile.write(reinterpret_cast<const char*>(&stockID), sizeof(stockID));
+        outFile.write(reinterpret_cast<const char*>(&stockInfo.lastBuyValue), 1);
+        outFile.write(reinterpret_cast<const char*>(&stockInfo.lastSellValue), 1);
+        outFile.write(reinterpret_cast<const char*>(&flags), 1);
+    }
+}
+
+bool readCheckpoint(ifstream& inFile, StockMap& stockData) {
+    uint32_t numStocks = 0;
+    if(!inFile.read(reinterpret_cast<char*>(&numStocks), sizeof(numStocks)))
+        return false;
+    for(uint32_t s=0;s<numStocks;s++) {
+        uint32_t stockID;
+        uint8_t flags;
+        StockInfo info;
+        inFile.read(reinterpret_cast<char*>(&stockID), sizeof(stockID));
+        inFile.read(reinterpret_cast<char*>(&info.lastBuyValue), 1);
+        inFile.read(reinterpret_cast<char*>(&info.lastSellValue), 1);
+        inFile.read(reinterpret_cast<char*>(&flags), 1);
+        // a corrupt count must not spin past the end of the file
+        if(!inFile)
+            return false;
+        info.hasBuy = flags & 1;
+        info.hasSell = flags & 2;
+        stockData.emplace_hint(stockData.end(), stockID, info);
+    }
+    return true;
+}
+
+bool readCheckpointHeader(ifstream& inFile, const string& indexFile, CheckpointHeader& header, OrderBookView orderBook) {
+    if(!inFile.is_open()) {
+        cerr << "Error opening file: " << indexFile << endl;
+        return false;
+    }
+    if(!inFile.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+       !equal(header.magic, header.magic + 4, CHECKPOINT_MAGIC) || header.interval == 0) {
+        cerr << "Invalid checkpoint index: " << indexFile << endl;
+        return false;
+    }
+    if(header.numOrders != orderBook.size()) {
+        cerr << "Checkpoint index " << indexFile << " covers " << header.numOrders
+             << " orders, order book has " << orderBook.size() << endl;
+        return false;
+    }
+    if(header.numCheckpoints != 1 + header.numOrders/header.interval ||
+       header.bookHash != hashOrders(orderBook.orders, orderBook.size())) {
+        cerr << "Checkpoint index " << indexFile << " was written for a different order book" << endl;
+        return false;
+    }
+    return true;
+}
+
+bool writeCheckpointIndex(OrderBookView orderBook, int32_t interval, const std::string &indexFile) {
+    return writeCheckpointIndex(orderBook, interval, indexFile, defaultContext());
+}
+
+bool writeCheckpointIndex(OrderBookView orderBook, int32_t interval, const std::string &indexFile, OrderBookContext &ctx) {
+    if(interval <= 0) {
+        cerr << "Checkpoint interval must be positive, got " << interval << endl;
+        return false;
+    }
+
+    ofstream outFile(indexFile, ios::binary);
+    if(!outFile.is_open()) {
+        cerr << "Error opening file: " << indexFile << endl;
+        return false;
+    }
+
+    int n = orderBook.size();
+    CheckpointHeader header;
+    copy(CHECKPOINT_MAGIC, CHECKPOINT_MAGIC + 4, header.magic);
+    header.interval = interval;
+    header.numOrders = n;
+    header.numCheckpoints = 1 + n/interval;
+    header.bookHash = hashOrders(orderBook.orders, orderBook.size());
+
+    // offsets are patched in once every record has been written
+    vector<uint64_t> offsets(header.numCheckpoints, 0);
+    outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    outFile.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+
+    ctx.prepare(1);
+    StockMap currentData{ArenaAllocator<StockMap::value_type>(ctx.shared())};
+    for(int i=0;i<=n;i++) {
+        if(i%interval == 0) {
+            offsets[i/interval] = outFile.tellp();
+            writeCheckpoint(outFile, currentData);
+        }
+        if(i < n)
+            applyOrder(currentData, decodePacket(orderBook[i]));
+    }
+
+    outFile.seekp(sizeof(header));
+    outFile.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+    outFile.close();
+
+    if(!outFile) {
+        cerr << "Error writing checkpoint index: " << indexFile << endl;
+        return false;
+    }
+    return true;
+}
+
+// Rebuilds one snapshot from an already validated index stream.
+bool rebuildSnapShot(OrderBookView orderBook, int32_t freq, int snapShotID,
+                     ifstream& inFile, const CheckpointHeader& header, ThreadScratch& scratch) {
+    int n = orderBook.size();
+    int end = (int)min<int64_t>((int64_t)(snapShotID + 1) * freq, n);
+    int checkpointID = end / header.interval;
+
+    uint64_t offset = 0;
+    inFile.seekg(sizeof(header) + checkpointID * sizeof(uint64_t));
+    inFile.read(reinterpret_cast<char*>(&offset), sizeof(offset));
+    inFile.seekg(offset);
+
+    // nothing else lives in this thread's arena while snapshots are rebuilt
+    scratch.arena.reset();
+    StockMap stockData{ArenaAllocator<StockMap::value_type>(scratch.arena)};
+    if(!readCheckpoint(inFile, stockData)) {
+        cerr << "Corrupt checkpoint " << checkpointID << " for snapshot " << snapShotID << endl;
+        return false;
+    }
+    for(int i=checkpointID * (int)header.interval;i<end;i++)
+        applyOrder(stockData, decodePacket(orderBook[i]));
+
+    ArenaVector<SnapShotEntry> entries{ArenaAllocator<SnapShotEntry>(scratch.arena)};
+    entries.reserve(stockData.size());
+    appendSnapShotEntries(entries, stockData);
+    return generateSnapShot(snapShotID, entries.data(), entries.data() + entries.size(), scratch);
+}
+
+bool regenerateSnapShot(OrderBookView orderBook, int32_t freq, int32_t snapShotID, const std::string &indexFile) {
+    return regenerateSnapShots(orderBook, freq, snapShotID, snapShotID, indexFile, defaultContext());
+}
+
+bool regenerateSnapShot(OrderBookView orderBook, int32_t freq, int32_t snapShotID, const std::string &indexFile, OrderBookContext &ctx) {
+    return regenerateSnapShots(orderBook, freq, snapShotID, snapShotID, indexFile, ctx);
+}
+
+bool regenerateSnapShots(OrderBookView orderBook, int32_t freq, int32_t firstID, int32_t lastID, const std::string &indexFile) {
+    return regenerateSnapShots(orderBook, freq, firstID, lastID, indexFile, defaultContext());
+}
+
+bool regenerateSnapShots(OrderBookView orderBook, int32_t freq, int32_t firstID, int32_t lastID, const std::string &indexFile, OrderBookContext &ctx) {
+    if(freq <= 0) {
+        cerr << "Snapshot frequency must be positive, got " << freq << endl;
+        return false;
+    }
+    int numSanpShots = 1 + (orderBook.size()/freq);
+    if(firstID < 0 || lastID >= numSanpShots || firstID > lastID) {
+        cerr << "Snapshot range [" << firstID << ", " << lastID << "] out of bounds, book has "
+             << numSanpShots << " snapshots" << endl;
+        return false;
+    }
+
+    // validated once here, the threads below only reopen the stream
+    CheckpointHeader header;
+    {
+        ifstream inFile(indexFile, ios::binary);
+        if(!readCheckpointHeader(inFile, indexFile, header, orderBook))
+            return false;
+    }
+
+    ctx.prepare(omp_get_max_threads());
+
+    // each thread seeks its own stream, snapshots come from independent checkpoints
+    bool failed = false;
+    #pragma omp parallel reduction(||:failed)
+    {
+        ThreadScratch& scratch = ctx.thread(omp_get_thread_num());
+        ifstream inFile(indexFile, ios::binary);
+
+        #pragma omp for schedule(dynamic)
+        for(int i=firstID;i<=lastID;i++) {
+            if(!rebuildSnapShot(orderBook, freq, i, inFile, header, scratch))
+                failed = true;
+        }
+    }
+    return !failed;
+}
+
+
+
+// Per-thread context
+void OrderBookContext::prepare(int numThreads) {
+    if((int)threads.size() < numThreads)
+        threads.resize(numThreads);
+
+    sharedArena.reset();
+
+    // a thread's arena keeps the pages it first touched, so it must own its scratch
+    int teamSize = numThreads;
+    #pragma omp parallel num_threads(numThreads)
+    {
+        int thread_id = omp_get_thread_num();
+        #pragma omp single nowait
+        teamSize = omp_get_num_threads();
+
+        if(pinThreads)
+            pinThreadToCore(thread_id);
+        else if(threadsPinned)
+            unpinThread();
+
+        if(!threads[thread_id])
+            threads[thread_id] = make_unique<ThreadScratch>();
+        threads[thread_id]->arena.reset();
+    }
+
+    threadsPinned = pinThreads;
+
+    // slots the team did not reach: a smaller team than requested, or earlier larger teams
+    for(int t=teamSize;t<(int)threads.size();t++) {
+        if(!threads[t])
+            threads[t] = make_unique<ThreadScratch>();
+        threads[t]->arena.reset();
+    }
+}
+
+void OrderBookContext::reportAllocatorStats(std::ostream &out) const {
+    auto report = [&](const string& name, const Arena& arena) {
+        out << setw(8) << name
+            << setw(14) << arena.heapAllocations()
+            << setw(14) << arena.bytesReserved()
+            << setw(14) << arena.peakBytes()
+            << setw(16) << arena.totalBytesServed()
+            << setw(10) << arena.numResets() << "\n";
+    };
+
+    out << setw(8) << "arena" << setw(14) << "heap_allocs" << setw(14) << "reserved_B"
+        << setw(14) << "peak_B" << setw(16) << "served_B" << setw(10) << "resets" << "\n";
+    report("shared", sharedArena);
+    for(size_t t=0;t<threads.size();t++)
+        report("t" + to_string(t), threads[t]->arena);
+}
+
+OrderBookContext& defaultContext() {
+    // one per calling thread, so the overloads without a context stay safe to call concurrently
+    thread_local OrderBookContext ctx;
+    return ctx;
+}
+
+// Incremental state
+/*
+ Sidecar "<book>.state" layout:
+ 1. IncrementalHeader
+ 2. numStats stats records: stockID (4 bytes), minSellValue, maxBuyValue, flags (1 byte each),
+    totalValue, orderCount (8 bytes each)
+ 3. the display state after numOrders orders, as one checkpoint record
+
+ Outputs go to "<book>.out/", so books sharing a directory never see each other's
+ snapshots. The sidecar is replaced atomically after stats.txt and the snapshots are
+ written, so a run that dies halfway simply redoes the same tail on the next call.
+*/
+struct IncrementalHeader {
+    char magic[4];
+    int32_t freq;
+    uint64_t numOrders;
+    int64_t totalAmount;
+    uint64_t prefixHash;
+    uint64_t numStats;
+};
+
+static const char INCREMENTAL_MAGIC[4] = {'O', 'B', 'S', 'T'};
+// bytes per stats record in the sidecar
+static const size_t STATS_RECORD_SIZE = 4 + 3 + 8 + 8;
+static const size_t HASH_BLOCK_ORDERS = 8192;
+
+// hashOrders over the first numOrders packets of the file, read sequentially in blocks
+bool hashBookPrefix(const std::string &bookFile, uint64_t numOrders, uint64_t &hash) {
+    ifstream inFile(bookFile, ios::binary);
+    uint64_t packets[HASH_BLOCK_ORDERS];
+
+    hash = FNV_OFFSET;
+    for(uint64_t done=0;done<numOrders;) {
+        size_t count = min<uint64_t>(HASH_BLOCK_ORDERS, numOrders - done);
+        if(!inFile.read(reinterpret_cast<char*>(packets), count * sizeof(uint64_t)))
+            return false;
+        hash = hashOrders(packets, count, hash);
+        done += count;
+    }
+    return true;
+}
+
+// Loads the sidecar into stats/display; false if it is missing or does not match the book.
+bool loadIncrementalState(const std::string &stateFile, const std::string &bookFile, int32_t freq, size_t bookOrders,
+                          IncrementalHeader& header, StatsMap& statsData, StockMap& displayData) {
+    ifstream inFile(stateFile, ios::binary | ios::ate);
+    if(!inFile.is_open())
+        return false;
+    size_t fileSize = inFile.tellg();
+    inFile.seekg(0);
+
+    if(!inFile.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+       !equal(header.magic, header.magic + 4, INCREMENTAL_MAGIC)) {
+        cerr << "Invalid incremental state " << stateFile << ", recomputing" << endl;
+        return false;
+    }
+
+    // the whole processed prefix is checked, any rewrite before the offset forces a full run
+    uint64_t prefixHash;
+    if(header.freq != freq || header.numOrders > bookOrders ||
+       !hashBookPrefix(bookFile, header.numOrders, prefixHash) || prefixHash != header.prefixHash) {
+        cerr << "Incremental state " << stateFile << " does not match " << bookFile << ", recomputing" << endl;
+        return false;
+    }
+    if(header.numStats > (fileSize - sizeof(header)) / STATS_RECORD_SIZE) {
+        cerr << "Corrupt incremental state " << stateFile << ", recomputing" << endl;
+        return false;
+    }
+
+    for(uint64_t s=0;s<header.numStats;s++) {
+        StockStats stats;
+        uint8_t flags;
+        inFile.read(reinterpret_cast<char*>(&stats.stockID), sizeof(stats.stockID));
+        inFile.read(reinterpret_cast<char*>(&stats.minSellValue), 1);
+        inFile.read(reinterpret_cast<char*>(&stats.maxBuyValue), 1);
+        inFile.read(reinterpret_cast<char*>(&flags), 1);
+        inFile.read(reinterpret_cast<char*>(&stats.totalValue), sizeof(stats.totalValue));
+        inFile.read(reinterpret_cast<char*>(&stats.orderCount), sizeof(stats.orderCount));
+        if(!inFile)
+            break;
+        stats.hasBuy = flags & 1;
+        stats.hasSell = flags & 2;
+        statsData.emplace_hint(statsData.end(), stats.stockID, stats);
+    }
+
+    if(!inFile || !readCheckpoint(inFile, displayData)) {
+        cerr << "Corrupt incremental state " << stateFile << ", recomputing" << endl;
+        statsData.clear();
+        displayData.clear();
+        return false;
+    }
+    return true;
+}
+
+bool saveIncrementalState(const std::string &stateFile, const IncrementalHeader& header,
+                          const StatsMap& statsData, const StockMap& displayData) {
+    string tmpFile = stateFile + ".tmp";
+    ofstream outFile(tmpFile, ios::binary);
+    if(!outFile.is_open()) {
+        cerr << "Error opening file: " << tmpFile << endl;
+        return false;
+    }
+
+    outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for(const auto& [stockID, stats]:statsData) {
+        uint8_t flags = (stats.hasBuy ? 1 : 0) | (stats.hasSell ? 2 : 0);
+        outFile.write(reinterpret_cast<const char*>(&stockID), sizeof(stockID));
+        outFile.write(reinterpret_cast<const char*>(&stats.minSellValue), 1);
+        outFile.write(reinterpret_cast<const char*>(&stats.maxBuyValue), 1);
+        outFile.write(reinterpret_cast<const char*>(&flags), 1);
+        outFile.write(reinterpret_cast<const char*>(&stats.totalValue), sizeof(stats.totalValue));
+        outFile.write(reinterpret_cast<const char*>(&stats.orderCount), sizeof(stats.orderCount));
+    }
+    writeCheckpoint(outFile, displayData);
+    outFile.close();
+
+    if(!outFile || rename(tmpFile.c_str(), stateFile.c_str()) != 0) {
+        cerr << "Error writing incremental state " << stateFile << endl;
+        return false;
+    }
+    return true;
+}
+
+bool updateIncremental(const std::string &bookFile, int32_t freq, int64_t &totalAmount) {
+    return updateIncremental(bookFile, freq, totalAmount, defaultContext());
+}
+
+bool updateIncremental(const std::string &bookFile, int32_t freq, int64_t &totalAmount, OrderBookContext &ctx) {
+    if(freq <= 0) {
+        cerr << "Snapshot frequency must be positive, got " << freq << endl;
+        return false;
+    }
+    ifstream probe(bookFile, ios::binary | ios::ate);
+    if(!probe.is_open()) {
+        cerr << "Error opening file: " << bookFile << endl;
+        return false;
+    }
+    // a packet still being appended is left for the next run
+    size_t bookOrders = (size_t)probe.tellg() / sizeof(uint64_t);
+    probe.close();
+
+    string stateFile = bookFile + ".state";
+    string outputPrefix = bookFile + ".out/";
+    error_code ec;
+    filesystem::create_directories(outputPrefix, ec);
+    if(ec) {
+        cerr << "Error creating " << outputPrefix << ": " << ec.message() << endl;
+        return false;
+    }
+
+    ctx.prepare(omp_get_max_threads());
+    StatsMap statsData{StatsAllocator(ctx.shared())};
+    StockMap displayData{ArenaAllocator<StockMap::value_type>(ctx.shared())};
+
+    IncrementalHeader header;
+    bool loaded = loadIncrementalState(stateFile, bookFile, freq, bookOrders, header, statsData, displayData);
+
+    // the outputs the state refers to must still be there, else they are rebuilt from scratch
+    if(loaded && !filesystem::exists(outputPrefix + "stats.txt")) {
+        statsData.clear();
+        displayData.clear();
+        loaded = false;
+    }
+    if(!loaded) {
+        // snapshots of an earlier freq or a longer book would survive a full recompute
+        for(const filesystem::directory_entry &entry : filesystem::directory_iterator(outputPrefix, ec)) {
+            string name = entry.path().filename().string();
+            if(name.compare(0, 5, "snap_") == 0 && !filesystem::remove(entry.path(), ec) && ec)
+                break;
+        }
+        if(ec) {
+            cerr << "Error clearing " << outputPrefix << ": " << ec.message() << endl;
+            return false;
+        }
+        copy(INCREMENTAL_MAGIC, INCREMENTAL_MAGIC + 4, header.magic);
+        header.freq = freq;
+        header.numOrders = 0;
+        header.totalAmount = 0;
+        header.prefixHash = FNV_OFFSET;
+    }
+    else if(header.numOrders == bookOrders) {
+        totalAmount = header.totalAmount;
+        return true;
+    }
+
+    // exactly the range measured above, the book may keep growing meanwhile
+    OrderBookBuffer tail;
+    if(!OrderBookBuffer::readFromFile(bookFile, tail, header.numOrders, bookOrders))
+        return false;
+
+    // the previous last snapshot is rewritten, it now covers more orders
+    aggregateStats(tail, ctx, statsData);
+    bool written = writeStats(statsData, ctx.thread(0), outputPrefix.c_str());
+    written = buildSnapShots(tail, header.numOrders, freq, displayData, ctx, outputPrefix.c_str()) && written;
+
+    header.numOrders = bookOrders;
+    header.totalAmount += sumTradeAmounts(tail, ctx);
+    header.prefixHash = hashOrders(tail.data(), tail.size(), header.prefixHash);
+    header.numStats = statsData.size();
+
+    // the sidecar only ever advances past outputs that were written completely
+    if(!written || !saveIncrementalState(stateFile, header, statsData, displayData))
+        return false;
+    totalAmount = header.totalAmount;
+    return true;
+}
@@ -11,7 +11,70 @@
 #include <cmath>
 #include <omp.h>
 #include <iostream>
+#include <memory>
+#include "arena.h"
+#include "numa.h"
+#include "scheduler.h"
 
-void updateDisplay(const std::vector<uint64_t> &orderBook, int32_t freq);
-int64_t totalAmountTraded(const std::vector<uint64_t> &orderBook);
-void printOrderStats(const std::vector<uint64_t> &orderBook);
\ No newline at end of file
+// Per-thread scratch state, reused across calls so steady-state processing stays off the heap.
+struct alignas(64) ThreadScratch {
+    Arena arena;
+    char filename[1024];
+    char fileBuffer[1 << 16];
+    std::ofstream outFile;
+};
+
+// Owns the arenas and scratch buffers used by the processing functions. Every call
+// rewinds the arenas it uses, so a context must not be shared by concurrent calls.
+// Each thread creates and rewinds its own scratch, which keeps it on that thread's NUMA node.
+class OrderBookContext {
+    public:
+        OrderBookContext() : pinThreads(false), threadsPinned(false) {}
+
+        void prepare(int numThreads);
+        // Pin OpenMP thread t to the t-th allowed CPU on the next prepare() (Linux only);
+        // disabling it restores the threads' original affinity on the next prepare().
+        void setThreadPinning(bool enabled) { pinThreads = enabled; }
+        ThreadScratch& thread(int threadID) { return *threads[threadID]; }
+        Arena& shared() { return sharedArena; }
+        WorkStealingScheduler& scheduler() { return taskScheduler; }
+
+        void reportAllocatorStats(std::ostream &out) const;
+
+    private:
+        Arena sharedArena;
+        WorkStealingScheduler taskScheduler;
+        std::vector<std::unique_ptr<ThreadScratch>> threads;
+        bool pinThreads;
+        bool threadsPinned;
+};
+
+// Context used by the overloads that do not take one. Each calling thread gets its
+// own, so those overloads may be called concurrently from different threads.
+OrderBookContext& defaultContext();
+
+void updateDisplay(OrderBookView orderBook, int32_t freq);
+int64_t totalAmountTraded(OrderBookView orderBook);
+void printOrderStats(OrderBookView orderBook);
+void updateDisplay(OrderBookView orderBook, int32_t freq, OrderBookContext &ctx);
+void printOrderStats(OrderBookView orderBook, OrderBookContext &ctx);
+int64_t totalAmountTraded(OrderBookView orderBook, OrderBookContext &ctx);
+
+// Checkpoint index: per-stock display state every `interval` orders, so single
+// snapshots (or ranges of them) can be rebuilt without replaying the whole book.
+// All return false, after reporting on cerr, on bad arguments, I/O errors or an
+// index that was written for a different book (checked by length and hash).
+bool writeCheckpointIndex(OrderBookView orderBook, int32_t interval, const std::string &indexFile);
+bool regenerateSnapShot(OrderBookView orderBook, int32_t freq, int32_t snapShotID, const std::string &indexFile);
+bool regenerateSnapShots(OrderBookView orderBook, int32_t freq, int32_t firstID, int32_t lastID, const std::string &indexFile);
+bool writeCheckpointIndex(OrderBookView orderBook, int32_t interval, const std::string &indexFile, OrderBookContext &ctx);
+bool regenerateSnapShot(OrderBookView orderBook, int32_t freq, int32_t snapShotID, const std::string &indexFile, OrderBookContext &ctx);
+bool regenerateSnapShots(OrderBookView orderBook, int32_t freq, int32_t firstID, int32_t lastID, const std::string &indexFile, OrderBookContext &ctx);
+
+// Re-analyses only the orders appended to bookFile since the previous call, keeping the
+// mergeable state in "<bookFile>.state". Rewrites stats.txt, the last snapshot and any new
+// ones in "<bookFile>.out/" exactly as a full run would, and sets totalAmount to the whole
+// book's total. A rewritten prefix (checked by hash) or changed freq forces a full run. On any
+// error it returns false and leaves the sidecar untouched, so the next call redoes the tail.
+bool updateIncremental(const std::string &bookFile, int32_t freq, int64_t &totalAmount);
+bool updateIncremental(const std::string &bookFile, int32_t freq, int64_t &totalAmount, OrderBookContext &ctx);
\ No newline at end of file
@@ -0,0 +1,148 @@
+#include "numa.h"
+#include <omp.h>
+#include <fstream>
+#include <iostream>
+#include <new>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+using namespace std;
+
+static const size_t PAGE_SIZE = 4096;
+
+OrderBookView::OrderBookView(const OrderBookBuffer &orderBook) : orders(orderBook.data()), count(orderBook.size()) {}
+
+void OrderBookBuffer::PageDeleter::operator()(uint64_t* p) const {
+    ::operator delete(p, align_val_t(PAGE_SIZE));
+}
+
+OrderBookBuffer::OrderBookBuffer(size_t count)
+    : orders(static_cast<uint64_t*>(::operator new(max<size_t>(count, 1) * sizeof(uint64_t), align_val_t(PAGE_SIZE)))),
+      count(count) {
+    uint64_t* data = orders.get();
+
+    #pragma omp parallel
+    {
+        size_t first, last;
+        staticPartition(count, omp_get_thread_num(), omp_get_num_threads(), first, last);
+        fill(data + first, data + last, 0);
+    }
+}
+
+bool OrderBookBuffer::readFromFile(const std::string &filename, OrderBookBuffer &buffer, size_t firstOrder, size_t lastOrder) {
+    ifstream probe(filename, ios::binary | ios::ate);
+    if(!probe.is_open()) {
+        cerr << "Error opening file: " << filename << endl;
+        return false;
+    }
+    size_t total = (size_t)probe.tellg() / sizeof(uint64_t);
+    probe.close();
+
+    if(lastOrder == SIZE_MAX)
+        lastOrder = max(total, firstOrder);
+    if(firstOrder > lastOrder || lastOrder > total) {
+        cerr << "Orders [" << firstOrder << ", " << lastOrder << ") are not in " << filename
+             << ", which holds " << total << endl;
+        return false;
+    }
+    size_t n = lastOrder - firstOrder;
+
+    buffer = OrderBookBuffer(n);
+    uint64_t* data = buffer.data();
+    bool failed = false;
+
+    // every thread reads its own slice so the pages it touches stay local
+    #pragma omp parallel reduction(||:failed)
+    {
+        size_t first, last;
+        staticPartition(n, omp_get_thread_num(), omp_get_num_threads(), first, last);
+
+        ifstream inFile(filename, ios::binary);
+        inFile.seekg((firstOrder + first) * sizeof(uint64_t));
+        if(!inFile.read(reinterpret_cast<char*>(data + first), (last - first) * sizeof(uint64_t)))
+            failed = true;
+    }
+
+    if(failed) {
+        cerr << "Error reading file: " << filename << endl;
+        buffer = OrderBookBuffer();
+        return false;
+    }
+    return true;
+}
+
+OrderBookBuffer OrderBookBuffer::copyOf(const std::vector<uint64_t> &orderBook) {
+    size_t n = orderBook.size();
+    OrderBookBuffer buffer(n);
+    uint64_t* data = buffer.data();
+
+    #pragma omp parallel
+    {
+        size_t first, last;
+        staticPartition(n, omp_get_thread_num(), omp_get_num_threads(), first, last);
+        copy(orderBook.begin() + first, orderBook.begin() + last, data + first);
+    }
+    return buffer;
+}
+
+void staticPartition(size_t n, int threadID, int numThreads, size_t &first, size_t &last) {
+    size_t chunk = n / numThreads;
+    size_t extra = n % numThreads;
+    if((size_t)threadID < extra) {
+        chunk++;
+        extra = 0;
+    }
+    first = chunk * threadID + extra;
+    last = first + chunk;
+}
+
+#ifdef __linux__
+// Taken during static initialisation on the main thread, before any OpenMP region
+// has run or any thread has been pinned, so it is the process-wide mask.
+static const cpu_set_t processMask = [] {
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    sched_getaffinity(0, sizeof(mask), &mask);
+    return mask;
+}();
+#endif
+
+bool pinThreadToCore(int threadID) {
+#ifdef __linux__
+    // OMP_PROC_BIND/OMP_PLACES already bind the team, the runtime's placement wins
+    if(omp_get_proc_bind() != omp_proc_bind_false)
+        return false;
+
+    // pick the threadID-th allowed CPU, wrapping around when oversubscribed
+    int numAllowed = CPU_COUNT(&processMask);
+    if(numAllowed == 0)
+        return false;
+    int target = threadID % numAllowed;
+    for(int cpu=0;cpu<CPU_SETSIZE;cpu++) {
+        if(!CPU_ISSET(cpu, &processMask))
+            continue;
+        if(target-- == 0) {
+            cpu_set_t mask;
+            CPU_ZERO(&mask);
+            CPU_SET(cpu, &mask);
+            return sched_setaffinity(0, sizeof(mask), &mask) == 0;
+        }
+    }
+    return false;
+#else
+    (void)threadID;
+    return false;
+#endif
+}
+
+bool unpinThread() {
+#ifdef __linux__
+    if(omp_get_proc_bind() != omp_proc_bind_false)
+        return false;
+    return sched_setaffinity(0, sizeof(processMask), &processMask) == 0;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class OrderBookBuffer;
+
+// Non-owning view over packed orders, so the processing functions accept both a
+// plain std::vector and a NUMA-placed OrderBookBuffer.
+struct OrderBookView {
+    const uint64_t* orders;
+    size_t count;
+
+    OrderBookView(const std::vector<uint64_t> &orderBook) : orders(orderBook.data()), count(orderBook.size()) {}
+    OrderBookView(const OrderBookBuffer &orderBook);
+
+    size_t size() const { return count; }
+    const uint64_t& operator[](size_t i) const { return orders[i]; }
+};
+
+// Order book storage whose pages are first touched in parallel. Thread t writes
+// the t-th contiguous slice, which is roughly the range the scheduler first deals
+// to worker t, so on a multi-socket machine most of a thread's orders are on its
+// own NUMA node. Stolen chunks, and books too small to give every worker a chunk,
+// are read remotely.
+class OrderBookBuffer {
+    public:
+        OrderBookBuffer() : count(0) {}
+        // Allocates without touching, then zero-fills each thread's slice from that thread.
+        explicit OrderBookBuffer(size_t count);
+
+        // Reads orders [firstOrder, lastOrder) of the file into buffer, by default up to the
+        // last whole packet. False, with buffer left empty, if the file cannot be opened, is
+        // shorter than the range or a read fails.
+        static bool readFromFile(const std::string &filename, OrderBookBuffer &buffer,
+                                 size_t firstOrder = 0, size_t lastOrder = SIZE_MAX);
+        static OrderBookBuffer copyOf(const std::vector<uint64_t> &orderBook);
+
+        uint64_t* data() { return orders.get(); }
+        const uint64_t* data() const { return orders.get(); }
+        size_t size() const { return count; }
+        uint64_t& operator[](size_t i) { return orders[i]; }
+        const uint64_t& operator[](size_t i) const { return orders[i]; }
+
+    private:
+        struct PageDeleter {
+            void operator()(uint64_t* p) const;
+        };
+
+        std::unique_ptr<uint64_t[], PageDeleter> orders;
+        size_t count;
+};
+
+// [first, last) of thread `threadID` out of `numThreads` for n iterations, the
+// same contiguous split libgomp and LLVM's runtime use for schedule(static). Used
+// for first touch; the scheduler's cost-based deal only approximates it.
+void staticPartition(size_t n, int threadID, int numThreads, size_t &first, size_t &last);
+
+// Binds the calling thread to the threadID-th CPU of the process affinity mask, as
+// it was at startup. Linux only, elsewhere it is a no-op and returns false. Also a
+// no-op when OMP_PROC_BIND is in effect, since the runtime already places threads.
+bool pinThreadToCore(int threadID);
+// Restores the calling thread to the startup process mask, undoing pinThreadToCore.
+bool unpinThread();
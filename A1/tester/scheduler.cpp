@@ -0,0 +1,88 @@
+#include "scheduler.h"
+#include <algorithm>
+#include <iomanip>
+
+using namespace std;
+
+static const size_t MIN_CHUNK_ORDERS = 4096;
+static const size_t CHUNKS_PER_THREAD = 8;
+
+void WorkStealingScheduler::ensureWorkers(int numThreads) {
+    while((int)workers.size() < numThreads)
+        workers.push_back(make_unique<Worker>());
+}
+
+void WorkStealingScheduler::distribute(const WorkItem* items, size_t numItems, int numThreads) {
+    activeWorkers = numThreads;
+
+    uint64_t totalCost = 0;
+    for(size_t i=0;i<numItems;i++)
+        totalCost += items[i].cost;
+
+    // worker w takes items until the running cost passes (w+1)/numThreads of the total
+    size_t index = 0;
+    uint64_t runningCost = 0;
+    for(int w=0;w<numThreads;w++) {
+        Worker& worker = *workers[w];
+        worker.head = index;
+        uint64_t target = totalCost * (w + 1) / numThreads;
+        while(index < numItems && (w == numThreads - 1 || runningCost + items[index].cost / 2 < target))
+            runningCost += items[index++].cost;
+        worker.tail = index;
+        worker.stats = WorkerStats{0.0, 0.0, 0, 0};
+    }
+}
+
+bool WorkStealingScheduler::next(int threadID, size_t &index) {
+    Worker& self = *workers[threadID];
+    {
+        lock_guard<mutex> guard(self.lock);
+        if(self.head < self.tail) {
+            index = self.head++;
+            return true;
+        }
+    }
+
+    // own deque is empty, steal from the far end of the others
+    for(int k=1;k<activeWorkers;k++) {
+        Worker& victim = *workers[(threadID + k) % activeWorkers];
+        lock_guard<mutex> guard(victim.lock);
+        if(victim.head < victim.tail) {
+            index = --victim.tail;
+            self.stats.stolen++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingScheduler::reportLoadBalance(std::ostream &out) const {
+    out << setw(8) << "thread" << setw(12) << "busy_ms" << setw(12) << "idle_ms"
+        << setw(10) << "tasks" << setw(10) << "stolen" << "\n";
+
+    ios_base::fmtflags flags = out.flags();
+    out << fixed << setprecision(3);
+    for(int t=0;t<activeWorkers;t++) {
+        const WorkerStats& s = workers[t]->stats;
+        out << setw(8) << t << setw(12) << s.busySeconds * 1000.0 << setw(12) << s.idleSeconds * 1000.0
+            << setw(10) << s.executed << setw(10) << s.stolen << "\n";
+    }
+    out.flags(flags);
+}
+
+size_t numOrderChunks(size_t n, int numThreads) {
+    size_t chunks = (size_t)numThreads * CHUNKS_PER_THREAD;
+    chunks = min(chunks, (n + MIN_CHUNK_ORDERS - 1) / MIN_CHUNK_ORDERS);
+    return max<size_t>(chunks, 1);
+}
+
+void makeOrderChunks(size_t n, WorkItem* chunks, size_t numChunks) {
+    // same contiguous split as staticPartition, with chunks in place of threads
+    size_t size = n / numChunks;
+    size_t extra = n % numChunks;
+    for(size_t c=0;c<numChunks;c++) {
+        size_t first = c * size + min(c, extra);
+        size_t last = first + size + (c < extra ? 1 : 0);
+        chunks[c] = {first, last, last - first};
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+#include <omp.h>
+
+// One unit of schedulable work: a range of orders or a range of snapshot ids,
+// with an estimated cost used to balance the initial distribution.
+struct WorkItem {
+    size_t first;
+    size_t last;
+    uint64_t cost;
+};
+
+// Work-stealing scheduler over a fixed set of WorkItems. Items are split into
+// contiguous per-worker deques of roughly equal estimated cost, so each thread
+// starts on its own region of the book. A worker pops from the front of its deque
+// and, once empty, steals from the back of the others. Busy and idle time of the
+// last run are kept per thread.
+class WorkStealingScheduler {
+    public:
+        WorkStealingScheduler() : activeWorkers(0) {}
+
+        struct WorkerStats {
+            double busySeconds;
+            double idleSeconds;
+            size_t executed;
+            size_t stolen;
+        };
+
+        // Runs body(item, threadID) for every item on a new OpenMP team.
+        template <typename Body>
+        void run(const WorkItem* items, size_t numItems, Body&& body);
+
+        int numWorkers() const { return activeWorkers; }
+        const WorkerStats& stats(int threadID) const { return workers[threadID]->stats; }
+        void reportLoadBalance(std::ostream &out) const;
+
+    private:
+        struct alignas(64) Worker {
+            std::mutex lock;
+            size_t head;
+            size_t tail;
+            WorkerStats stats;
+        };
+
+        void ensureWorkers(int numThreads);
+        void distribute(const WorkItem* items, size_t numItems, int numThreads);
+        bool next(int threadID, size_t &index);
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        int activeWorkers;
+};
+
+template <typename Body>
+void WorkStealingScheduler::run(const WorkItem* items, size_t numItems, Body&& body) {
+    ensureWorkers(omp_get_max_threads());
+
+    #pragma omp parallel
+    {
+        int thread_id = omp_get_thread_num();
+        #pragma omp single
+        distribute(items, numItems, omp_get_num_threads());
+
+        Worker& self = *workers[thread_id];
+        double start = omp_get_wtime();
+        size_t index;
+        while(next(thread_id, index)) {
+            double taskStart = omp_get_wtime();
+            body(items[index], thread_id);
+            self.stats.busySeconds += omp_get_wtime() - taskStart;
+            self.stats.executed++;
+        }
+
+        // time spent waiting for the slowest worker counts as idle
+        #pragma omp barrier
+        self.stats.idleSeconds = omp_get_wtime() - start - self.stats.busySeconds;
+    }
+}
+
+// Number of order chunks for n orders: several per thread so there is something
+// to steal, but never smaller than a few thousand orders.
+size_t numOrderChunks(size_t n, int numThreads);
+// Fills chunks[0..numChunks) with contiguous order ranges covering [0, n), cost = length.
+void makeOrderChunks(size_t n, WorkItem* chunks, size_t numChunks);
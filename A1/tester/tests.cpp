@@ -2,6 +2,7 @@
 #include "functions.h"
 #include <assert.h>
 #include <random>
+#include <filesystem>
 
 int random_int(int l, int r) {
     static std::mt19937 rng(std::random_device{}());
@@ -95,6 +96,109 @@ void generateTC(std::string filename, int freq, long long size)
     outFile.close();
 }
 
+bool sameFile(const std::string &a, const std::string &b)
+{
+    std::ifstream fa(a, std::ios::binary), fb(b, std::ios::binary);
+    if(!fa.is_open() || !fb.is_open())
+        return false;
+    return std::string(std::istreambuf_iterator<char>(fa), {}) == std::string(std::istreambuf_iterator<char>(fb), {});
+}
+
+// check every snapshot against the sequential reference, snap_<i>.txt under prefix
+bool checkSnapshots(const std::string &prefix, long long size, int freq)
+{
+    bool ok = true;
+    for(long long i = 0; i <= size / freq; ++i)
+    {
+        std::string name = prefix + "snap_" + std::to_string(i) + ".txt";
+        if(!sameFile(name, "snap_correct_" + std::to_string(i) + ".txt"))
+        {
+            std::cout << "MISMATCH " << name << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// rebuild every snapshot (and one from the middle on its own) from a checkpoint index
+bool testCheckpoints(const std::vector<uint64_t> &orderBook, int freq, long long size)
+{
+    const std::string indexFile = "checkpoints.idx";
+    int numSnapShots = 1 + size / freq;
+    for(int i = 0; i < numSnapShots; ++i)
+        std::remove(("snap_" + std::to_string(i) + ".txt").c_str());
+
+    bool rejected = !writeCheckpointIndex(orderBook, 0, indexFile);
+    bool indexed = writeCheckpointIndex(orderBook, std::max(1, freq / 3 + 1), indexFile);
+    bool range = regenerateSnapShots(orderBook, freq, 0, numSnapShots - 1, indexFile);
+    bool single = regenerateSnapShot(orderBook, freq, numSnapShots / 2, indexFile);
+
+    bool ok = rejected && indexed && range && single && checkSnapshots("", size, freq);
+    std::cout << "checkpoint regeneration: " << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok;
+}
+
+// number of snap_*.txt files in dir
+long long countSnapshots(const std::string &dir)
+{
+    long long count = 0;
+    for(const auto &entry : std::filesystem::directory_iterator(dir))
+        if(entry.path().filename().string().rfind("snap_", 0) == 0)
+            ++count;
+    return count;
+}
+
+// writes the first `cut` bytes of the book to `book` and runs updateIncremental on it
+bool runIncremental(const std::string &book, const std::string &bytes, size_t cut, int freq, int64_t &total)
+{
+    std::ofstream outFile(book, std::ios::binary | std::ios::trunc);
+    outFile.write(bytes.data(), std::min(cut, bytes.size()));
+    outFile.close();
+    return updateIncremental(book, freq, total);
+}
+
+// grow a copy of the book in steps (on and off freq boundaries, and mid-packet) and
+// check the incremental outputs against a full run, then change freq and shrink the
+// book and check no stale snapshots are left behind
+bool testIncremental(const std::string &filename, int freq, long long size)
+{
+    const std::string book = "incremental_" + filename;
+    const std::string outDir = book + ".out/";
+    std::filesystem::remove(book);
+    std::filesystem::remove(book + ".state");
+    std::filesystem::remove_all(outDir);
+
+    std::ifstream inFile(filename, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(inFile)), {});
+
+    long long onBoundary = (size / freq / 2) * freq;
+    long long offBoundary = std::min(size, onBoundary + freq / 2 + 1);
+    std::vector<size_t> cuts = {0, (size_t)onBoundary * 8, (size_t)offBoundary * 8 + 3, bytes.size()};
+
+    bool ran = true;
+    int64_t total = -1;
+    for(size_t cut : cuts)
+        ran = runIncremental(book, bytes, cut, freq, total) && ran;
+
+    bool ok = ran && checkSnapshots(outDir, size, freq) && sameFile(outDir + "stats.txt", "stats.txt") &&
+              total == totalAmountTraded_seq(readFromFile(filename));
+
+    // a new freq, then a shorter book, each recompute from scratch
+    int otherFreq = freq + 1;
+    long long half = size / 2;
+    bool refreq = runIncremental(book, bytes, bytes.size(), otherFreq, total) &&
+                  countSnapshots(outDir) == 1 + size / otherFreq;
+    bool shrunk = runIncremental(book, bytes, (size_t)half * 8, otherFreq, total) &&
+                  countSnapshots(outDir) == 1 + half / otherFreq;
+    bool regrown = runIncremental(book, bytes, bytes.size(), freq, total) &&
+                   countSnapshots(outDir) == 1 + size / freq && checkSnapshots(outDir, size, freq) &&
+                   sameFile(outDir + "stats.txt", "stats.txt");
+
+    ok = ok && refreq && shrunk && regrown;
+    std::cout << "incremental re-analysis: " << (ok ? "PASS" : "FAIL") << std::endl;
+    return ok;
+}
+
 int main(int argc, char* argv[])
 {
     //get the filename, frequency and size from command line arguments
@@ -118,8 +222,11 @@ int main(int argc, char* argv[])
     printOrderStats(orderBook);
     std::cout << "total amount traded (parallel version) is " << totalAmountTraded(orderBook) << std::endl;
 
+    bool passed = testCheckpoints(orderBook, freq, size);
+    passed = testIncremental(filename, freq, size) && passed;
+
 
     //To debug
     printorderbook(readFromFile(filename));
-    return 0;
+    return passed ? 0 : 1;
 }